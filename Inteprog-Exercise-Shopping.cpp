@@ -1,7 +1,25 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <cstdint>
 #include <iomanip>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <new>
+#include <algorithm>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
 using namespace std;
 
 class Prod;
@@ -12,56 +30,170 @@ const int MAX_PRODUCTS = 150;
 const int MAX_ORDERS = 50;
 const int MAX_INPUT_LENGTH = 100;
 const int MAX_CART_ITEMS = 100;
+const int MAX_PAYMENT_METHODS = 8;
+const int MAX_PENDING_PAYMENTS = 256;
+const int MAX_PAYMENT_BATCH = 64;
+const int MAX_PAYMENT_WORKERS = 8;
+const int POOL_TASKS_PER_WORKER = 4;
+const int MAX_PRODUCT_ID_LENGTH = 10;
+const int MAX_PRODUCT_NAME_LENGTH = 50;
+// Sized for an average of 24 bytes of ID and name per product, including both
+// terminators, rather than the worst case of full-length strings.
+const int STRING_POOL_SIZE = MAX_PRODUCTS * 24;
+const int CACHE_LINE_SIZE = 64;
+const int ORDER_ID_BLOCK_SIZE = 16;
+const int SHARED_ATTACH_TIMEOUT_MS = 5000;
+
+// Both segments are owner-only: a process that can map the catalog must also
+// be able to attach to the control block, so the catalog gains nothing from
+// wider permissions.
+const int SHARED_SEGMENT_MODE = 0600;
+
+const char* const SHARED_CATALOG_NAME = "/inteprog_shopping_catalog";
+const char* const SHARED_CONTROL_NAME = "/inteprog_shopping_control";
+
+typedef uint32_t StringHandle;
+typedef uint32_t ProductHandle;
+
+const ProductHandle INVALID_PRODUCT_HANDLE = 0xFFFFFFFF;
+
+
+// Stores each distinct string once; a handle is the offset of the string
+// in the pool.
+class StringPool {
+private:
+    char data[STRING_POOL_SIZE];
+    uint32_t used;
+
+public:
+    StringPool() : used(1) {
+        data[0] = '\0';
+    }
+
+    StringHandle intern(const char* value) {
+        uint32_t offset = 1;
+        while (offset < used) {
+            if (strcmp(data + offset, value) == 0) {
+                return offset;
+            }
+            offset += (uint32_t) strlen(data + offset) + 1;
+        }
+
+        uint32_t length = (uint32_t) strlen(value) + 1;
+        if (used + length > (uint32_t) STRING_POOL_SIZE) {
+            throw runtime_error("Error: String pool is full!");
+        }
+        memcpy(data + used, value, length);
+        used += length;
+        return offset;
+    }
+
+    // True if both values can be interned without overflowing, whether or
+    // not they are already in the pool.
+    bool hasRoomFor(const char* first, const char* second) const {
+        return used + strlen(first) + strlen(second) + 2 <= (size_t) STRING_POOL_SIZE;
+    }
+
+    const char* get(StringHandle handle) const {
+        return (handle < used) ? data + handle : data;
+    }
+
+    uint32_t getUsedBytes() const {
+        return used;
+    }
+
+    uint32_t getCapacity() const {
+        return STRING_POOL_SIZE;
+    }
+};
 
 
 class Prod {
 private:
-    char id[10];
-    char name[50];
+    StringHandle id;
+    StringHandle name;
     double price;
 
 
 public:
-    Prod() {
-        strcpy(id, "");
-        strcpy(name, "");
-        price = 0.0;
-    }
+    Prod() : id(0), name(0), price(0.0) {}
 
 
-    Prod(const char* pid, const char* pname, double pprice) {
-        strcpy(id, pid);
-        strcpy(name, pname);
-        price = pprice;
-    }
+    Prod(StringHandle pid, StringHandle pname, double pprice)
+        : id(pid), name(pname), price(pprice) {}
 
 
-    const char* getId() const { return id; }
-    const char* getName() const { return name; }
+    StringHandle getIdHandle() const { return id; }
+    StringHandle getNameHandle() const { return name; }
     double getPrice() const { return price; }
 };
 
+// A cart or order line. The product is referenced by its catalog handle and
+// resolved only when the line is rendered; the price is captured when the
+// line is created.
 class CartItem {
 private:
-    Prod product;
+    ProductHandle product;
     int quantity;
+    double price;
 
 
 public:
-    CartItem() : quantity(0) {}
+    CartItem() : product(INVALID_PRODUCT_HANDLE), quantity(0), price(0.0) {}
    
-    CartItem(const Prod& p, int q) : product(p), quantity(q) {}
+    CartItem(ProductHandle p, int q, double pprice) : product(p), quantity(q), price(pprice) {}
    
-    const Prod& getProduct() const { return product; }
+    ProductHandle getProduct() const { return product; }
     int getQuantity() const { return quantity; }
     void setQuantity(int q) { quantity = q; }
-    double getTotalPrice() const { return product.getPrice() * quantity; }
+    double getPrice() const { return price; }
+    double getTotalPrice() const { return price * quantity; }
+};
+
+static_assert(CACHE_LINE_SIZE % sizeof(CartItem) == 0, "Cart lines must pack evenly into a cache line");
+
+// Member lists of the classes from when product strings were stored inline
+// and the whole product was copied into every line. Only used by the memory
+// report, so that it compares against the old sizes rather than estimates.
+struct InlineProductLayout {
+    char id[MAX_PRODUCT_ID_LENGTH];
+    char name[MAX_PRODUCT_NAME_LENGTH];
+    double price;
+};
+
+struct InlineCartItemLayout {
+    InlineProductLayout product;
+    int quantity;
+};
+
+struct InlineOrderLayout {
+    int id;
+    InlineCartItemLayout items[MAX_CART_ITEMS];
+    int itemCount;
+    double totalAmount;
+    PaymentStrategy* paymentMethod;
+    char paymentMethodName[20];
+};
+
+struct InlineShoppingCartLayout {
+    InlineCartItemLayout items[MAX_CART_ITEMS];
+    int itemCount;
+};
+
+struct InlineOrderManagerLayout {
+    InlineOrderLayout orders[MAX_ORDERS];
+    int orderCount;
+};
+
+struct InlineProductCatalogLayout {
+    InlineProductLayout products[MAX_PRODUCTS];
+    int productCount;
 };
 
 class PaymentStrategy {
 public:
     virtual ~PaymentStrategy() {}
-    virtual void pay(double amount) = 0;
+    virtual bool pay(double amount, ostream& receipt) = 0;
     virtual const char* getMethodName() const = 0;
     virtual PaymentStrategy* clone() const = 0; 
 };
@@ -69,8 +201,12 @@ public:
 
 class CashPayment : public PaymentStrategy {
 public:
-    void pay(double amount) override {
-        cout << "Paid $" << fixed << setprecision(2) << amount << " using Cash" << endl;
+    bool pay(double amount, ostream& receipt) override {
+        if (amount <= 0.0) {
+            return false;
+        }
+        receipt << "Paid $" << fixed << setprecision(2) << amount << " using Cash";
+        return true;
     }
    
     const char* getMethodName() const override {
@@ -85,8 +221,12 @@ public:
 
 class CardPayment : public PaymentStrategy {
 public:
-    void pay(double amount) override {
-        cout << "Paid $" << fixed << setprecision(2) << amount << " using the payment method of Credit/Debit Card" << endl;
+    bool pay(double amount, ostream& receipt) override {
+        if (amount <= 0.0) {
+            return false;
+        }
+        receipt << "Paid $" << fixed << setprecision(2) << amount << " using the payment method of Credit/Debit Card";
+        return true;
     }
    
     const char* getMethodName() const override {
@@ -101,8 +241,12 @@ public:
 
 class GCashPayment : public PaymentStrategy {
 public:
-    void pay(double amount) override {
-        cout << "Paid $" << fixed << setprecision(2) << amount << " using the payment method of GCash" << endl;
+    bool pay(double amount, ostream& receipt) override {
+        if (amount <= 0.0) {
+            return false;
+        }
+        receipt << "Paid $" << fixed << setprecision(2) << amount << " using the payment method of GCash";
+        return true;
     }
    
     const char* getMethodName() const override {
@@ -114,6 +258,24 @@ public:
     }
 };
 
+enum OrderStatus {
+    ORDER_PENDING,
+    ORDER_PAID,
+    ORDER_FAILED
+};
+
+const char* getOrderStatusName(OrderStatus status) {
+    switch (status) {
+        case ORDER_PENDING:
+            return "Pending";
+        case ORDER_PAID:
+            return "Paid";
+        case ORDER_FAILED:
+            return "Failed";
+    }
+    return "Unknown";
+}
+
 class Order {
 private:
     int id;
@@ -122,15 +284,16 @@ private:
     double totalAmount;
     PaymentStrategy* paymentMethod; 
     char paymentMethodName[20];  
+    OrderStatus status;
 
 
 public:
-    Order() : id(0), itemCount(0), totalAmount(0.0), paymentMethod(nullptr) {
+    Order() : id(0), itemCount(0), totalAmount(0.0), paymentMethod(nullptr), status(ORDER_PENDING) {
         strcpy(paymentMethodName, "");
     }
    
     Order(int orderId, const CartItem* cartItems, int count, PaymentStrategy* payment)
-        : id(orderId), itemCount(0), totalAmount(0.0), paymentMethod(nullptr) {
+        : id(orderId), itemCount(0), totalAmount(0.0), paymentMethod(nullptr), status(ORDER_PENDING) {
 
         for (int i = 0; i < count && i < MAX_CART_ITEMS; i++) { 
             items[i] = cartItems[i];
@@ -153,7 +316,7 @@ public:
         paymentMethod = nullptr;  
     }
 
-    Order(const Order& other) : id(other.id), itemCount(other.itemCount), totalAmount(other.totalAmount), paymentMethod(nullptr) {
+    Order(const Order& other) : id(other.id), itemCount(other.itemCount), totalAmount(other.totalAmount), paymentMethod(nullptr), status(other.status) {
 
         for (int i = 0; i < itemCount && i < MAX_CART_ITEMS; i++) { 
             items[i] = other.items[i];
@@ -172,6 +335,7 @@ public:
             id = other.id;
             itemCount = other.itemCount;
             totalAmount = other.totalAmount;
+            status = other.status;
 
             for (int i = 0; i < itemCount && i < MAX_CART_ITEMS; i++) { 
                 items[i] = other.items[i];
@@ -195,25 +359,43 @@ public:
     double getTotalAmount() const { return totalAmount; }
     const PaymentStrategy* getPaymentMethod() const { return paymentMethod; }
     const char* getPaymentMethodName() const { return paymentMethodName; }
+    OrderStatus getStatus() const { return status; }
+    void setStatus(OrderStatus newStatus) { status = newStatus; }
 };
 
 
-class ProductCatalog {
-private:
+// Plain catalog contents, kept free of pointers so that one copy can be
+// mapped read-only into several processes.
+struct CatalogData {
     Prod products[MAX_PRODUCTS];
     int productCount;
+    StringPool strings;
+
+    CatalogData() : productCount(0) {}
+};
+
+class ProductCatalog {
+private:
+    CatalogData* localData;
+    const CatalogData* data;
    
-    ProductCatalog() : productCount(0) {
-        addProduct(Prod("A", "Lipstick", 159));
-        addProduct(Prod("B", "Blush", 299));
-        addProduct(Prod("C", "Mascara", 149));
-        addProduct(Prod("D", "Eye Shadow Palette", 399));
-        addProduct(Prod("E", "Brush for Blush", 79));
-        addProduct(Prod("F", "Lip Gloss", 88));
-        addProduct(Prod("G", "Highligter", 115));
-        addProduct(Prod("H", "Eyebrow Pencil", 129));
-        addProduct(Prod("I", "Eyeliner", 69));
-        addProduct(Prod("J", "Foundation Liquid", 599));
+    ProductCatalog() : localData(new CatalogData()), data(nullptr) {
+        data = localData;
+        addProduct("A", "Lipstick", 159);
+        addProduct("B", "Blush", 299);
+        addProduct("C", "Mascara", 149);
+        addProduct("D", "Eye Shadow Palette", 399);
+        addProduct("E", "Brush for Blush", 79);
+        addProduct("F", "Lip Gloss", 88);
+        addProduct("G", "Highligter", 115);
+        addProduct("H", "Eyebrow Pencil", 129);
+        addProduct("I", "Eyeliner", 69);
+        addProduct("J", "Foundation Liquid", 599);
+    }
+
+    ~ProductCatalog() {
+        delete localData;
+        localData = nullptr;
     }
    
 public:
@@ -226,30 +408,69 @@ public:
     ProductCatalog(const ProductCatalog&) = delete;
     ProductCatalog& operator=(const ProductCatalog&) = delete;
    
-    void addProduct(const Prod& product) {
-        if (productCount < MAX_PRODUCTS) {
-            products[productCount++] = product;
+    void addProduct(const char* id, const char* name, double price) {
+        if (localData == nullptr) {
+            cout << "Error: The shared catalog is read-only!" << endl;
+        } else if (localData->productCount < MAX_PRODUCTS && localData->strings.hasRoomFor(id, name)) {
+            StringHandle idHandle = localData->strings.intern(id);
+            StringHandle nameHandle = localData->strings.intern(name);
+            localData->products[localData->productCount++] = Prod(idHandle, nameHandle, price);
         } else {
             cout << "Error: Prod catalog is full!" << endl;
         }
     }
+
+    // Switches to a catalog mapped from shared memory and frees the private copy.
+    void attachShared(const CatalogData* shared) {
+        delete localData;
+        localData = nullptr;
+        data = shared;
+    }
+
+    bool isShared() const {
+        return localData == nullptr;
+    }
+
+    const CatalogData& getData() const {
+        return *data;
+    }
    
     const Prod* getProducts() const {
-        return products;
+        return data->products;
     }
    
     int getProductCount() const {
-        return productCount;
+        return data->productCount;
+    }
+
+    const Prod& getProduct(ProductHandle handle) const {
+        return data->products[handle];
+    }
+
+    const char* getProductId(ProductHandle handle) const {
+        return data->strings.get(data->products[handle].getIdHandle());
+    }
+
+    const char* getProductName(ProductHandle handle) const {
+        return data->strings.get(data->products[handle].getNameHandle());
+    }
+
+    size_t getStringPoolBytes() const {
+        return data->strings.getUsedBytes();
+    }
+
+    size_t getStringPoolCapacity() const {
+        return data->strings.getCapacity();
     }
    
-    const Prod* findProductById(const char* id) const {
-        for (int i = 0; i < productCount; i++) {
+    ProductHandle findProductById(const char* id) const {
+        for (ProductHandle i = 0; i < (ProductHandle) data->productCount; i++) {
 
-            if (strcasecmp(products[i].getId(), id) == 0) {
-                return &products[i];
+            if (strcasecmp(getProductId(i), id) == 0) {
+                return i;
             }
         }
-        return nullptr;
+        return INVALID_PRODUCT_HANDLE;
     }
    
     void displayProducts() const {
@@ -258,34 +479,365 @@ public:
              << setw(20) << left << "Name"
              << setw(10) << right << "Price ($)" << endl;
        
-        for (int i = 0; i < productCount; i++) {
-            cout << setw(15) << left << products[i].getId()
-                 << setw(20) << left << products[i].getName()
-                 << setw(10) << right << fixed << setprecision(2) << products[i].getPrice() << endl;
+        for (ProductHandle i = 0; i < (ProductHandle) data->productCount; i++) {
+            cout << setw(15) << left << getProductId(i)
+                 << setw(20) << left << getProductName(i)
+                 << setw(10) << right << fixed << setprecision(2) << data->products[i].getPrice() << endl;
         }
         cout << endl;
     }
 };
 
+// Hands out order IDs. In shared mode IDs come from a counter shared by every
+// process on the host, reserved a block at a time so that most orders never
+// touch the shared cache line.
+class OrderIdAllocator {
+private:
+    atomic<int>* sharedNextId;
+    int nextId;
+    int blockEnd;
+
+public:
+    OrderIdAllocator() : sharedNextId(nullptr), nextId(1), blockEnd(0) {}
+
+    void useShared(atomic<int>* counter) {
+        sharedNextId = counter;
+        nextId = 0;
+        blockEnd = 0;
+    }
+
+    int allocate() {
+        if (sharedNextId == nullptr) {
+            return nextId++;
+        }
+        if (nextId == blockEnd) {
+            nextId = sharedNextId->fetch_add(ORDER_ID_BLOCK_SIZE, memory_order_relaxed);
+            blockEnd = nextId + ORDER_ID_BLOCK_SIZE;
+        }
+        return nextId++;
+    }
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Shared order IDs need a lock-free atomic int");
+
+struct SharedControlBlock {
+    atomic<int> ready;
+    atomic<int> nextOrderId;
+    // Number of attached processes. It only drops to zero when the last
+    // process detaches, and attach never raises it from zero, so a block
+    // that reached zero is retired for good.
+    atomic<int> attachedProcesses;
+};
+
+enum SharedAttachResult {
+    SHARED_ATTACHED,
+    SHARED_RETRY,
+    SHARED_FAILED
+};
+
+// Owns the two shared memory segments used when several instances run on one
+// host: a read-only copy of the catalog and a small control block holding the
+// order ID counter. The first process to attach creates and fills both; the
+// last one to detach removes them.
+//
+// If a process dies while creating the segments, the control block is never
+// marked ready and later instances refuse to attach until it is removed with
+// --shared-reset.
+class SharedMemoryHost {
+private:
+    SharedControlBlock* control;
+    const CatalogData* catalog;
+    bool created;
+    char lastError[200];
+
+    SharedMemoryHost() : control(nullptr), catalog(nullptr), created(false) {
+        lastError[0] = '\0';
+    }
+
+    void setError(const char* message) {
+        snprintf(lastError, sizeof(lastError), "%s", message);
+    }
+
+#ifndef _WIN32
+    void setSystemError(const char* what) {
+        snprintf(lastError, sizeof(lastError), "%s: %s", what, strerror(errno));
+    }
+
+    static void* mapSegment(int fd, size_t size, int protection) {
+        void* address = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+        return (address == MAP_FAILED) ? nullptr : address;
+    }
+
+    static bool waitFor(bool (*condition)(int fd, SharedControlBlock* control), int fd, SharedControlBlock* block) {
+        for (int waited = 0; waited < SHARED_ATTACH_TIMEOUT_MS; waited += 10) {
+            if (condition(fd, block)) {
+                return true;
+            }
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        return condition(fd, block);
+    }
+
+    static bool isSized(int fd, SharedControlBlock*) {
+        struct stat info;
+        return fstat(fd, &info) == 0 && info.st_size >= (off_t) sizeof(SharedControlBlock);
+    }
+
+    static bool isReady(int, SharedControlBlock* block) {
+        return block->ready.load(memory_order_acquire) == 1;
+    }
+
+    // Joins the processes already attached; fails if the block was retired.
+    static bool retain(SharedControlBlock* block) {
+        int count = block->attachedProcesses.load();
+        while (count > 0) {
+            if (block->attachedProcesses.compare_exchange_weak(count, count + 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool createSegments(int controlFd, const CatalogData& seed) {
+        if (ftruncate(controlFd, sizeof(SharedControlBlock)) != 0) {
+            setSystemError("Could not size the shared control segment");
+            return false;
+        }
+        control = static_cast<SharedControlBlock*>(mapSegment(controlFd, sizeof(SharedControlBlock), PROT_READ | PROT_WRITE));
+        if (control == nullptr) {
+            setSystemError("Could not map the shared control segment");
+            return false;
+        }
+
+        // Anything still under the catalog name is left over from a crash.
+        shm_unlink(SHARED_CATALOG_NAME);
+        int catalogFd = shm_open(SHARED_CATALOG_NAME, O_CREAT | O_EXCL | O_RDWR, SHARED_SEGMENT_MODE);
+        if (catalogFd == -1) {
+            setSystemError("Could not create the shared catalog segment");
+            return false;
+        }
+        if (ftruncate(catalogFd, sizeof(CatalogData)) != 0) {
+            setSystemError("Could not size the shared catalog segment");
+            close(catalogFd);
+            return false;
+        }
+        void* writable = mapSegment(catalogFd, sizeof(CatalogData), PROT_READ | PROT_WRITE);
+        if (writable == nullptr) {
+            setSystemError("Could not map the shared catalog segment");
+            close(catalogFd);
+            return false;
+        }
+        new (writable) CatalogData(seed);
+        munmap(writable, sizeof(CatalogData));
+        catalog = static_cast<const CatalogData*>(mapSegment(catalogFd, sizeof(CatalogData), PROT_READ));
+        if (catalog == nullptr) {
+            setSystemError("Could not map the shared catalog segment read-only");
+        }
+        close(catalogFd);
+        if (catalog == nullptr) {
+            return false;
+        }
+
+        control->nextOrderId.store(1, memory_order_relaxed);
+        control->attachedProcesses.store(1, memory_order_relaxed);
+        control->ready.store(1, memory_order_release);
+        return true;
+    }
+
+    SharedAttachResult openSegments(int controlFd) {
+        const char* NOT_READY = "The shared control segment was never initialised, probably because "
+            "the process creating it crashed. Run with --shared-reset to remove it.";
+
+        if (!waitFor(&SharedMemoryHost::isSized, controlFd, nullptr)) {
+            setError(NOT_READY);
+            return SHARED_FAILED;
+        }
+        control = static_cast<SharedControlBlock*>(mapSegment(controlFd, sizeof(SharedControlBlock), PROT_READ | PROT_WRITE));
+        if (control == nullptr) {
+            setSystemError("Could not map the shared control segment");
+            return SHARED_FAILED;
+        }
+        if (!waitFor(&SharedMemoryHost::isReady, controlFd, control)) {
+            setError(NOT_READY);
+            return SHARED_FAILED;
+        }
+        if (!retain(control)) {
+            // The last process is detaching; its segments are about to go.
+            munmap(control, sizeof(SharedControlBlock));
+            control = nullptr;
+            return SHARED_RETRY;
+        }
+
+        int catalogFd = shm_open(SHARED_CATALOG_NAME, O_RDONLY, 0);
+        if (catalogFd == -1) {
+            setSystemError("Could not open the shared catalog segment");
+            detach();
+            return SHARED_FAILED;
+        }
+        catalog = static_cast<const CatalogData*>(mapSegment(catalogFd, sizeof(CatalogData), PROT_READ));
+        if (catalog == nullptr) {
+            setSystemError("Could not map the shared catalog segment");
+        }
+        close(catalogFd);
+        if (catalog == nullptr) {
+            detach();
+            return SHARED_FAILED;
+        }
+        return SHARED_ATTACHED;
+    }
+
+    SharedAttachResult tryAttach(const CatalogData& seed) {
+        int controlFd = shm_open(SHARED_CONTROL_NAME, O_CREAT | O_EXCL | O_RDWR, SHARED_SEGMENT_MODE);
+        if (controlFd != -1) {
+            created = true;
+            bool ok = createSegments(controlFd, seed);
+            close(controlFd);
+            if (!ok) {
+                unmapSegments();
+                shm_unlink(SHARED_CATALOG_NAME);
+                shm_unlink(SHARED_CONTROL_NAME);
+                created = false;
+                return SHARED_FAILED;
+            }
+            return SHARED_ATTACHED;
+        }
+        if (errno != EEXIST) {
+            setSystemError("Could not create the shared control segment");
+            return SHARED_FAILED;
+        }
+
+        controlFd = shm_open(SHARED_CONTROL_NAME, O_RDWR, 0);
+        if (controlFd == -1) {
+            if (errno == ENOENT) {
+                return SHARED_RETRY;
+            }
+            setSystemError("Could not open the shared control segment");
+            return SHARED_FAILED;
+        }
+        SharedAttachResult result = openSegments(controlFd);
+        close(controlFd);
+        if (result == SHARED_FAILED) {
+            unmapSegments();
+        }
+        return result;
+    }
+
+    void unmapSegments() {
+        if (catalog != nullptr) {
+            munmap(const_cast<CatalogData*>(catalog), sizeof(CatalogData));
+            catalog = nullptr;
+        }
+        if (control != nullptr) {
+            munmap(control, sizeof(SharedControlBlock));
+            control = nullptr;
+        }
+    }
+#endif
+
+public:
+    static SharedMemoryHost& getInstance() {
+        static SharedMemoryHost instance;
+        return instance;
+    }
+
+    ~SharedMemoryHost() {
+        detach();
+    }
+
+    SharedMemoryHost(const SharedMemoryHost&) = delete;
+    SharedMemoryHost& operator=(const SharedMemoryHost&) = delete;
+
+    // Creates the segments from seed if this is the first process, otherwise
+    // maps the ones already published. Returns false if shared memory is not
+    // available, in which case nothing is mapped and getLastError() says why.
+    bool attach(const CatalogData& seed) {
+        if (control != nullptr) {
+            return true;
+        }
+#ifdef _WIN32
+        (void) seed;
+        setError("Shared memory mode is not supported on this platform.");
+        return false;
+#else
+        for (int waited = 0; waited < SHARED_ATTACH_TIMEOUT_MS; waited += 10) {
+            SharedAttachResult result = tryAttach(seed);
+            if (result != SHARED_RETRY) {
+                return result == SHARED_ATTACHED;
+            }
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        setError("Timed out waiting for retired shared segments to be removed. "
+            "Run with --shared-reset if no other instance is running.");
+        return false;
+#endif
+    }
+
+    void detach() {
+#ifndef _WIN32
+        if (control == nullptr) {
+            return;
+        }
+        bool last = (control->attachedProcesses.fetch_sub(1) == 1);
+        unmapSegments();
+        if (last) {
+            // The catalog goes first: a new control block can only be created
+            // once the old name is gone, and by then so is the old catalog.
+            shm_unlink(SHARED_CATALOG_NAME);
+            shm_unlink(SHARED_CONTROL_NAME);
+        }
+#endif
+    }
+
+    // Removes the segments regardless of who is attached. Only meant for
+    // cleaning up after a crash while no instance is running.
+    static void removeSegments() {
+#ifndef _WIN32
+        shm_unlink(SHARED_CATALOG_NAME);
+        shm_unlink(SHARED_CONTROL_NAME);
+#endif
+    }
+
+    bool isAttached() const {
+        return control != nullptr;
+    }
+
+    bool isCreator() const {
+        return created;
+    }
+
+    const char* getLastError() const {
+        return lastError;
+    }
+
+    const CatalogData* getCatalog() const {
+        return catalog;
+    }
+
+    atomic<int>* getOrderIdCounter() const {
+        return (control != nullptr) ? &control->nextOrderId : nullptr;
+    }
+};
+
 class ShoppingCart {
 private:
-    CartItem items[MAX_CART_ITEMS];
+    alignas(CACHE_LINE_SIZE) CartItem items[MAX_CART_ITEMS];
     int itemCount;
    
 public:
     ShoppingCart() : itemCount(0) {}
    
-    void addProduct(const Prod& product, int quantity) {
+    void addProduct(ProductHandle product, int quantity) {
 
         for (int i = 0; i < itemCount; i++) {
-            if (strcasecmp(items[i].getProduct().getId(), product.getId()) == 0) {
+            if (items[i].getProduct() == product) {
                 items[i].setQuantity(items[i].getQuantity() + quantity);
                 return;
             }
         }
 
         if (itemCount < MAX_CART_ITEMS) {
-            items[itemCount++] = CartItem(product, quantity);
+            double price = ProductCatalog::getInstance().getProduct(product).getPrice();
+            items[itemCount++] = CartItem(product, quantity, price);
         } else {
             cout << "Error: Shopping cart is full!" << endl;
         }
@@ -324,11 +876,12 @@ public:
              << setw(10) << right << "Quantity"
              << setw(12) << right << "Total ($)" << endl;
        
+        const ProductCatalog& catalog = ProductCatalog::getInstance();
         for (int i = 0; i < itemCount; i++) {
-            const Prod& product = items[i].getProduct();
-            cout << setw(15) << left << product.getId()
-                 << setw(20) << left << product.getName()
-                 << setw(10) << right << fixed << setprecision(2) << product.getPrice()
+            ProductHandle product = items[i].getProduct();
+            cout << setw(15) << left << catalog.getProductId(product)
+                 << setw(20) << left << catalog.getProductName(product)
+                 << setw(10) << right << fixed << setprecision(2) << items[i].getPrice()
                  << setw(10) << right << items[i].getQuantity()
                  << setw(12) << right << fixed << setprecision(2) << items[i].getTotalPrice() << endl;
         }
@@ -340,13 +893,303 @@ public:
     }
 };
 
+typedef void (*PoolTask)(void* context, int taskIndex);
+
+// Keeps a group of worker threads for the life of the pool and runs batches
+// of tasks on them. Each worker starts with a contiguous block of task
+// indices and, once its own queue is empty, steals from the front of the
+// other workers' queues.
+class WorkStealingPool {
+private:
+    struct WorkerQueue {
+        int* tasks;
+        int head;
+        int tail;
+        mutex queueMutex;
+    };
+
+    WorkerQueue* queues;
+    thread* threads;
+    int workerCount;
+    int maxTasks;
+    PoolTask currentTask;
+    void* currentContext;
+    unsigned long generation;
+    int busyWorkers;
+    bool stopping;
+    mutex runMutex;
+    mutex stateMutex;
+    condition_variable workReady;
+    condition_variable workDone;
+
+    bool popLocal(int worker, int& taskIndex) {
+        WorkerQueue& queue = queues[worker];
+        lock_guard<mutex> lock(queue.queueMutex);
+        if (queue.head == queue.tail) {
+            return false;
+        }
+        taskIndex = queue.tasks[--queue.tail];
+        return true;
+    }
+
+    bool steal(int thief, int& taskIndex) {
+        for (int i = 1; i < workerCount; i++) {
+            WorkerQueue& victim = queues[(thief + i) % workerCount];
+            lock_guard<mutex> lock(victim.queueMutex);
+            if (victim.head != victim.tail) {
+                taskIndex = victim.tasks[victim.head++];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void drain(int worker) {
+        int taskIndex;
+        while (popLocal(worker, taskIndex) || steal(worker, taskIndex)) {
+            currentTask(currentContext, taskIndex);
+        }
+    }
+
+    void workerLoop(int worker) {
+        unsigned long seenGeneration = 0;
+
+        while (true) {
+            {
+                unique_lock<mutex> lock(stateMutex);
+                while (!stopping && generation == seenGeneration) {
+                    workReady.wait(lock);
+                }
+                if (stopping) {
+                    return;
+                }
+                seenGeneration = generation;
+            }
+
+            drain(worker);
+
+            {
+                lock_guard<mutex> lock(stateMutex);
+                if (--busyWorkers == 0) {
+                    workDone.notify_all();
+                }
+            }
+        }
+    }
+
+public:
+    // One worker per thread requested, however many that is; the queues
+    // are sized to match.
+    WorkStealingPool(int threadCount)
+        : queues(nullptr), threads(nullptr), workerCount(threadCount), maxTasks(0),
+          currentTask(nullptr), currentContext(nullptr),
+          generation(0), busyWorkers(0), stopping(false) {
+        if (workerCount < 1) workerCount = 1;
+        maxTasks = workerCount * POOL_TASKS_PER_WORKER;
+
+        queues = new WorkerQueue[workerCount];
+        threads = new thread[workerCount];
+        for (int w = 0; w < workerCount; w++) {
+            queues[w].tasks = new int[maxTasks];
+            queues[w].head = 0;
+            queues[w].tail = 0;
+        }
+        // Worker 0 is whichever thread calls run().
+        for (int w = 1; w < workerCount; w++) {
+            threads[w] = thread(&WorkStealingPool::workerLoop, this, w);
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            stopping = true;
+        }
+        workReady.notify_all();
+        for (int w = 1; w < workerCount; w++) {
+            threads[w].join();
+        }
+        for (int w = 0; w < workerCount; w++) {
+            delete[] queues[w].tasks;
+        }
+        delete[] threads;
+        delete[] queues;
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    int getWorkerCount() const {
+        return workerCount;
+    }
+
+    int getMaxTasks() const {
+        return maxTasks;
+    }
+
+    // Blocks until every task has run. Calls from several threads are run
+    // one after another.
+    void run(int taskCount, PoolTask task, void* context) {
+        lock_guard<mutex> runLock(runMutex);
+
+        if (taskCount > maxTasks) {
+            throw runtime_error("Error: Too many tasks for the thread pool!");
+        }
+
+        int next = 0;
+        for (int w = 0; w < workerCount; w++) {
+            int share = taskCount / workerCount + (w < taskCount % workerCount ? 1 : 0);
+            lock_guard<mutex> lock(queues[w].queueMutex);
+            queues[w].head = 0;
+            queues[w].tail = 0;
+            for (int i = 0; i < share; i++) {
+                queues[w].tasks[queues[w].tail++] = next++;
+            }
+        }
+
+        {
+            lock_guard<mutex> lock(stateMutex);
+            currentTask = task;
+            currentContext = context;
+            busyWorkers = workerCount - 1;
+            generation++;
+        }
+        workReady.notify_all();
+
+        drain(0);
+
+        unique_lock<mutex> lock(stateMutex);
+        while (busyWorkers > 0) {
+            workDone.wait(lock);
+        }
+    }
+};
+
+enum ExportFormat {
+    EXPORT_TEXT,
+    EXPORT_CSV
+};
+
 class OrderManager {
 private:
-    Order orders[MAX_ORDERS];
+    alignas(CACHE_LINE_SIZE) Order orders[MAX_ORDERS];
     int orderCount;
+    OrderIdAllocator orderIds;
+    bool loggingEnabled;
+    mutable mutex ordersMutex;
    
 
-    OrderManager() : orderCount(0) {}
+    OrderManager() : orderCount(0), loggingEnabled(true) {}
+
+    // Opens the order log for appending. Returns false if logging is turned
+    // off or the file cannot be opened.
+    bool openLog(ofstream& logFile) const {
+        if (!loggingEnabled) {
+            return false;
+        }
+        logFile.open("order_log.txt", ios::app);
+        if (!logFile.is_open()) {
+            cerr << "Warning: Could not open log file!" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    struct ExportJob {
+        const Order* orders;
+        int orderCount;
+        int chunkSize;
+        ExportFormat format;
+        string* buffers;
+    };
+
+    static void formatOrderText(ostream& out, const Order& order, bool isLast) {
+        out << "\nOrder ID: " << order.getId() << endl;
+        out << "Total Amount: $" << fixed << setprecision(2) << order.getTotalAmount() << endl;
+        out << "Payment Method: " << order.getPaymentMethodName() << endl;
+        out << "Payment Status: " << getOrderStatusName(order.getStatus()) << endl;
+        out << "Order Details: " << endl;
+       
+        out << setw(15) << left << "Product ID"
+            << setw(20) << left << "Name"
+            << setw(10) << right << "Price ($)"
+            << setw(10) << right << "Quantity" << endl;
+       
+        const ProductCatalog& catalog = ProductCatalog::getInstance();
+        const CartItem* items = order.getItems();
+        for (int j = 0; j < order.getItemCount(); j++) {
+            ProductHandle product = items[j].getProduct();
+            out << setw(15) << left << catalog.getProductId(product)
+                << setw(20) << left << catalog.getProductName(product)
+                << setw(10) << right << fixed << setprecision(2) << items[j].getPrice()
+                << setw(10) << right << items[j].getQuantity() << endl;
+        }
+       
+        if (!isLast) {
+            out << endl;
+        }
+    }
+
+    static void writeCsvField(ostream& out, const char* value) {
+        if (strpbrk(value, ",\"\n") == nullptr) {
+            out << value;
+            return;
+        }
+        out << '"';
+        for (const char* c = value; *c; c++) {
+            if (*c == '"') {
+                out << '"';
+            }
+            out << *c;
+        }
+        out << '"';
+    }
+
+    static void formatOrderCsv(ostream& out, const Order& order) {
+        const ProductCatalog& catalog = ProductCatalog::getInstance();
+        const CartItem* items = order.getItems();
+        for (int j = 0; j < order.getItemCount(); j++) {
+            ProductHandle product = items[j].getProduct();
+            out << order.getId() << ',';
+            writeCsvField(out, order.getPaymentMethodName());
+            out << ',' << getOrderStatusName(order.getStatus()) << ',';
+            writeCsvField(out, catalog.getProductId(product));
+            out << ',';
+            writeCsvField(out, catalog.getProductName(product));
+            out << ',' << fixed << setprecision(2) << items[j].getPrice()
+                << ',' << items[j].getQuantity()
+                << ',' << fixed << setprecision(2) << items[j].getTotalPrice() << endl;
+        }
+    }
+
+    // Formats one chunk of orders into its own buffer; runs on a pool worker.
+    static void formatExportChunk(void* context, int chunkIndex) {
+        ExportJob* job = static_cast<ExportJob*>(context);
+        int first = chunkIndex * job->chunkSize;
+        int last = first + job->chunkSize;
+        if (last > job->orderCount) {
+            last = job->orderCount;
+        }
+
+        ostringstream buffer;
+        for (int i = first; i < last; i++) {
+            if (job->format == EXPORT_CSV) {
+                formatOrderCsv(buffer, job->orders[i]);
+            } else {
+                formatOrderText(buffer, job->orders[i], i == job->orderCount - 1);
+            }
+        }
+        job->buffers[chunkIndex] = buffer.str();
+    }
+
+    Order* findOrderById(int orderId) {
+        for (int i = 0; i < orderCount; i++) {
+            if (orders[i].getId() == orderId) {
+                return &orders[i];
+            }
+        }
+        return nullptr;
+    }
    
 public:
 
@@ -359,59 +1202,451 @@ public:
     OrderManager& operator=(const OrderManager&) = delete;
    
     int createOrder(const ShoppingCart& cart, PaymentStrategy* paymentMethod) {
+        lock_guard<mutex> lock(ordersMutex);
+
         if (orderCount >= MAX_ORDERS) {
             throw runtime_error("Error: Maximum number of orders reached!");
         }
        
-        int newOrderId = orderCount + 1;
+        int newOrderId = orderIds.allocate();
         orders[orderCount] = Order(newOrderId, cart.getItems(), cart.getItemCount(), paymentMethod);
        
         // Log the order
-        ofstream logFile("order_log.txt", ios::app);
-        if (logFile.is_open()) {
+        ofstream logFile;
+        if (openLog(logFile)) {
             logFile << "[LOG] -> Order ID: " << newOrderId
-                   << " has been successfully checked out and paid using "
+                   << " has been checked out and is awaiting payment using "
                    << paymentMethod->getMethodName() << "." << endl;
             logFile.close();
-        } else {
-            cerr << "Warning: Could not open log file!" << endl;
         }
        
         orderCount++;
         return newOrderId;
     }
+
+    // Removes an order whose payment never reached the payment queue, freeing
+    // its slot so that the checkout can be retried.
+    void cancelOrder(int orderId) {
+        lock_guard<mutex> lock(ordersMutex);
+
+        for (int i = 0; i < orderCount; i++) {
+            if (orders[i].getId() != orderId) {
+                continue;
+            }
+            for (int j = i; j < orderCount - 1; j++) {
+                orders[j] = orders[j + 1];
+            }
+            orders[--orderCount] = Order();
+
+            ofstream logFile;
+            if (openLog(logFile)) {
+                logFile << "[LOG] -> Order ID: " << orderId
+                       << " has been cancelled because its payment could not be queued." << endl;
+                logFile.close();
+            }
+            return;
+        }
+    }
+
+    // Takes an order ID without recording an order, so the shared-memory
+    // self-test can draw more IDs than MAX_ORDERS would allow.
+    int reserveOrderId() {
+        lock_guard<mutex> lock(ordersMutex);
+        return orderIds.allocate();
+    }
+
+    // Lets tools such as the shared-memory self-test place orders without
+    // writing them to the order log.
+    void setLoggingEnabled(bool enabled) {
+        lock_guard<mutex> lock(ordersMutex);
+        loggingEnabled = enabled;
+    }
+
+    void useSharedOrderIds(atomic<int>* counter) {
+        lock_guard<mutex> lock(ordersMutex);
+        orderIds.useShared(counter);
+    }
+
+    // Called from the payment workers once the provider has settled an order.
+    void completePayment(int orderId, bool paid, const char* receipt) {
+        lock_guard<mutex> lock(ordersMutex);
+
+        Order* order = findOrderById(orderId);
+        if (order == nullptr) {
+            return;
+        }
+        order->setStatus(paid ? ORDER_PAID : ORDER_FAILED);
+
+        ofstream logFile;
+        if (openLog(logFile)) {
+            if (paid) {
+                logFile << "[LOG] -> Order ID: " << orderId
+                       << " has been successfully paid using "
+                       << order->getPaymentMethodName() << ". " << receipt << endl;
+            } else {
+                logFile << "[LOG] -> Order ID: " << orderId
+                       << " payment using " << order->getPaymentMethodName()
+                       << " has failed." << endl;
+            }
+            logFile.close();
+        }
+    }
    
     void displayOrders() const {
+        lock_guard<mutex> lock(ordersMutex);
+
         if (orderCount == 0) {
             cout << "No orders have been placed yet." << endl;
             return;
         }
        
         for (int i = 0; i < orderCount; i++) {
-            const Order& order = orders[i];
-            cout << "\nOrder ID: " << order.getId() << endl;
-            cout << "Total Amount: $" << fixed << setprecision(2) << order.getTotalAmount() << endl;
-            cout << "Payment Method: " << order.getPaymentMethodName() << endl;
-            cout << "Order Details: " << endl;
-           
-            cout << setw(15) << left << "Product ID"
-                 << setw(20) << left << "Name"
-                 << setw(10) << right << "Price ($)"
-                 << setw(10) << right << "Quantity" << endl;
-           
-            const CartItem* items = order.getItems();
-            for (int j = 0; j < order.getItemCount(); j++) {
-                const Prod& product = items[j].getProduct();
-                cout << setw(15) << left << product.getId()
-                     << setw(20) << left << product.getName()
-                     << setw(10) << right << fixed << setprecision(2) << product.getPrice()
-                     << setw(10) << right << items[j].getQuantity() << endl;
+            formatOrderText(cout, orders[i], i == orderCount - 1);
+        }
+    }
+
+    // Copies the orders under the lock, then formats and writes the copy so
+    // that payment settlement is not held up by the export.
+    int exportOrders(ostream& out, ExportFormat format, WorkStealingPool& pool) const {
+        Order* snapshot;
+        int count;
+        {
+            lock_guard<mutex> lock(ordersMutex);
+            count = orderCount;
+            snapshot = new Order[count];
+            for (int i = 0; i < count; i++) {
+                snapshot[i] = orders[i];
             }
-           
-            if (i < orderCount - 1) {
-                cout << endl;
+        }
+
+        try {
+            writeOrders(out, snapshot, count, format, pool);
+        } catch (...) {
+            delete[] snapshot;
+            throw;
+        }
+        delete[] snapshot;
+        return count;
+    }
+
+    // Splits the orders into chunks that are formatted in parallel and then
+    // written out in ID order, so the text output matches displayOrders().
+    static void writeOrders(ostream& out, const Order* orders, int count, ExportFormat format, WorkStealingPool& pool) {
+        if (format == EXPORT_CSV) {
+            out << "Order ID,Payment Method,Payment Status,Product ID,Name,Price ($),Quantity,Total ($)" << endl;
+        }
+        if (count == 0) {
+            return;
+        }
+
+        // A few chunks per worker leaves room for stealing when orders differ in size.
+        int targetChunks = pool.getMaxTasks();
+        int chunkSize = (count + targetChunks - 1) / targetChunks;
+        int chunkCount = (count + chunkSize - 1) / chunkSize;
+
+        string* buffers = new string[chunkCount];
+        ExportJob job;
+        job.orders = orders;
+        job.orderCount = count;
+        job.chunkSize = chunkSize;
+        job.format = format;
+        job.buffers = buffers;
+        try {
+            pool.run(chunkCount, &OrderManager::formatExportChunk, &job);
+        } catch (...) {
+            delete[] buffers;
+            throw;
+        }
+
+        for (int i = 0; i < chunkCount; i++) {
+            out << buffers[i];
+        }
+        delete[] buffers;
+    }
+};
+
+
+struct PaymentProcessorConfig {
+    int workerCount;
+    int maxBatchSize;
+    int providerLatencyMs;
+    int declineRatePercent;
+
+    PaymentProcessorConfig() : workerCount(2), maxBatchSize(16), providerLatencyMs(50), declineRatePercent(0) {}
+};
+
+struct PaymentRequest {
+    int orderId;
+    double amount;
+    chrono::steady_clock::time_point enqueuedAt;
+};
+
+struct PaymentStats {
+    int settledCount;
+    int paidCount;
+    int failedCount;
+    int batchCount;
+    double totalQueueMs;
+    double maxQueueMs;
+    double totalEndToEndMs;
+    double maxEndToEndMs;
+
+    PaymentStats() : settledCount(0), paidCount(0), failedCount(0), batchCount(0),
+        totalQueueMs(0.0), maxQueueMs(0.0), totalEndToEndMs(0.0), maxEndToEndMs(0.0) {}
+};
+
+typedef void (*PaymentSettledCallback)(int orderId, bool paid, const char* receipt);
+
+// Fixed-size FIFO of requests for a single payment method.
+class PaymentQueue {
+private:
+    PaymentStrategy* method;
+    PaymentRequest requests[MAX_PENDING_PAYMENTS];
+    int head;
+    int count;
+
+public:
+    PaymentQueue() : method(nullptr), head(0), count(0) {}
+
+    ~PaymentQueue() {
+        delete method;
+        method = nullptr;
+    }
+
+    PaymentQueue(const PaymentQueue&) = delete;
+    PaymentQueue& operator=(const PaymentQueue&) = delete;
+
+    void setMethod(const PaymentStrategy& prototype) {
+        delete method;
+        method = prototype.clone();
+    }
+
+    const PaymentStrategy* getMethod() const { return method; }
+    int getCount() const { return count; }
+
+    bool push(const PaymentRequest& request) {
+        if (count >= MAX_PENDING_PAYMENTS) {
+            return false;
+        }
+        requests[(head + count) % MAX_PENDING_PAYMENTS] = request;
+        count++;
+        return true;
+    }
+
+    int popBatch(PaymentRequest* batch, int maxCount) {
+        int taken = 0;
+        while (taken < maxCount && count > 0) {
+            batch[taken++] = requests[head];
+            head = (head + 1) % MAX_PENDING_PAYMENTS;
+            count--;
+        }
+        return taken;
+    }
+};
+
+// Settles payments off the checkout path. Requests are queued per payment
+// method and a pool of workers hands them to the (simulated) provider in
+// batches, so one provider round trip covers a whole batch.
+class PaymentProcessor {
+private:
+    PaymentProcessorConfig config;
+    PaymentSettledCallback onSettled;
+    PaymentQueue queues[MAX_PAYMENT_METHODS];
+    int queueCount;
+    int nextQueue;
+    int pendingCount;
+    int inFlightCount;
+    bool stopping;
+    PaymentStats stats;
+    thread workers[MAX_PAYMENT_WORKERS];
+    int workerCount;
+    mutable mutex queueMutex;
+    condition_variable workAvailable;
+    condition_variable idle;
+
+    int findQueue(const char* methodName) const {
+        for (int i = 0; i < queueCount; i++) {
+            if (strcmp(queues[i].getMethod()->getMethodName(), methodName) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    int takeNextBatch(PaymentRequest* batch, PaymentStrategy*& method) {
+        for (int i = 0; i < queueCount; i++) {
+            int index = (nextQueue + i) % queueCount;
+            if (queues[index].getCount() > 0) {
+                nextQueue = (index + 1) % queueCount;
+                method = queues[index].getMethod()->clone();
+                return queues[index].popBatch(batch, config.maxBatchSize);
+            }
+        }
+        return 0;
+    }
+
+    void settleBatch(PaymentStrategy* method, const PaymentRequest* batch, int count) {
+        static thread_local minstd_rand declineRng(
+            (unsigned) hash<thread::id>()(this_thread::get_id()));
+
+        chrono::steady_clock::time_point pickedUpAt = chrono::steady_clock::now();
+        this_thread::sleep_for(chrono::milliseconds(config.providerLatencyMs));
+
+        for (int i = 0; i < count; i++) {
+            ostringstream receipt;
+            bool paid = method->pay(batch[i].amount, receipt);
+            if (paid && config.declineRatePercent > 0 && (int) (declineRng() % 100) < config.declineRatePercent) {
+                paid = false;
+            }
+            chrono::steady_clock::time_point settledAt = chrono::steady_clock::now();
+
+            double queueMs = chrono::duration<double, milli>(pickedUpAt - batch[i].enqueuedAt).count();
+            double endToEndMs = chrono::duration<double, milli>(settledAt - batch[i].enqueuedAt).count();
+            {
+                lock_guard<mutex> lock(queueMutex);
+                stats.settledCount++;
+                if (paid) {
+                    stats.paidCount++;
+                } else {
+                    stats.failedCount++;
+                }
+                stats.totalQueueMs += queueMs;
+                stats.totalEndToEndMs += endToEndMs;
+                if (queueMs > stats.maxQueueMs) stats.maxQueueMs = queueMs;
+                if (endToEndMs > stats.maxEndToEndMs) stats.maxEndToEndMs = endToEndMs;
+            }
+
+            if (onSettled != nullptr) {
+                onSettled(batch[i].orderId, paid, receipt.str().c_str());
+            }
+        }
+    }
+
+    void workerLoop() {
+        PaymentRequest batch[MAX_PAYMENT_BATCH];
+
+        while (true) {
+            PaymentStrategy* method = nullptr;
+            int count = 0;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                while (!stopping && pendingCount == 0) {
+                    workAvailable.wait(lock);
+                }
+                if (pendingCount == 0) {
+                    return;
+                }
+                count = takeNextBatch(batch, method);
+                pendingCount -= count;
+                inFlightCount += count;
+                stats.batchCount++;
+            }
+
+            settleBatch(method, batch, count);
+            delete method;
+
+            {
+                lock_guard<mutex> lock(queueMutex);
+                inFlightCount -= count;
+                if (pendingCount == 0 && inFlightCount == 0) {
+                    idle.notify_all();
+                }
+            }
+        }
+    }
+
+public:
+    PaymentProcessor(const PaymentProcessorConfig& processorConfig, PaymentSettledCallback callback)
+        : config(processorConfig), onSettled(callback), queueCount(0), nextQueue(0),
+          pendingCount(0), inFlightCount(0), stopping(false), workerCount(0) {
+
+        if (config.workerCount < 1) config.workerCount = 1;
+        if (config.workerCount > MAX_PAYMENT_WORKERS) config.workerCount = MAX_PAYMENT_WORKERS;
+        if (config.maxBatchSize < 1) config.maxBatchSize = 1;
+        if (config.maxBatchSize > MAX_PAYMENT_BATCH) config.maxBatchSize = MAX_PAYMENT_BATCH;
+        if (config.providerLatencyMs < 0) config.providerLatencyMs = 0;
+
+        for (int i = 0; i < config.workerCount; i++) {
+            workers[workerCount++] = thread(&PaymentProcessor::workerLoop, this);
+        }
+    }
+
+    // Remaining payments are settled before the workers are joined.
+    ~PaymentProcessor() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (int i = 0; i < workerCount; i++) {
+            workers[i].join();
+        }
+    }
+
+    PaymentProcessor(const PaymentProcessor&) = delete;
+    PaymentProcessor& operator=(const PaymentProcessor&) = delete;
+
+    bool submit(int orderId, double amount, const PaymentStrategy& method) {
+        {
+            lock_guard<mutex> lock(queueMutex);
+
+            int index = findQueue(method.getMethodName());
+            if (index == -1) {
+                if (queueCount >= MAX_PAYMENT_METHODS) {
+                    return false;
+                }
+                index = queueCount++;
+                queues[index].setMethod(method);
+            }
+
+            PaymentRequest request;
+            request.orderId = orderId;
+            request.amount = amount;
+            request.enqueuedAt = chrono::steady_clock::now();
+            if (!queues[index].push(request)) {
+                return false;
             }
+            pendingCount++;
+        }
+        workAvailable.notify_one();
+        return true;
+    }
+
+    void waitUntilIdle() {
+        unique_lock<mutex> lock(queueMutex);
+        while (pendingCount > 0 || inFlightCount > 0) {
+            idle.wait(lock);
+        }
+    }
+
+    PaymentStats getStats() const {
+        lock_guard<mutex> lock(queueMutex);
+        return stats;
+    }
+
+    const PaymentProcessorConfig& getConfig() const {
+        return config;
+    }
+
+    void displayStats() const {
+        PaymentStats snapshot = getStats();
+
+        cout << "\nPayment Statistics\n";
+        cout << setw(30) << left << "Workers / Batch Size:" << config.workerCount << " / " << config.maxBatchSize << endl;
+        cout << setw(30) << left << "Provider Latency (ms):" << config.providerLatencyMs << endl;
+        cout << setw(30) << left << "Settled Payments:" << snapshot.settledCount
+             << " (" << snapshot.paidCount << " paid, " << snapshot.failedCount << " failed)" << endl;
+        cout << setw(30) << left << "Provider Batches:" << snapshot.batchCount << endl;
+
+        if (snapshot.settledCount == 0) {
+            cout << "No payments have been settled yet." << endl;
+            return;
         }
+
+        cout << setw(30) << left << "Avg / Max Queueing (ms):" << fixed << setprecision(2)
+             << snapshot.totalQueueMs / snapshot.settledCount << " / " << snapshot.maxQueueMs << endl;
+        cout << setw(30) << left << "Avg / Max End-to-End (ms):" << fixed << setprecision(2)
+             << snapshot.totalEndToEndMs / snapshot.settledCount << " / " << snapshot.maxEndToEndMs << endl;
     }
 };
 
@@ -556,13 +1791,21 @@ bool isValidProductId(const char* input) {
 class ShoppingApplication {
 private:
     ShoppingCart cart;
+    PaymentProcessor paymentProcessor;
+    WorkStealingPool exportPool;
+
+    static void onPaymentSettled(int orderId, bool paid, const char* receipt) {
+        OrderManager::getInstance().completePayment(orderId, paid, receipt);
+    }
    
     void displayMenu() const {
         cout << "\nShopping System Menu\n";
         cout << "1. View Products\n";
         cout << "2. View Shopping Cart\n";
         cout << "3. View Orders\n";
-        cout << "4. Exit\n";
+        cout << "4. Export Orders\n";
+        cout << "5. View Payment Statistics\n";
+        cout << "6. Exit\n";
         cout << "Enter your choice: ";
     }
    
@@ -588,8 +1831,8 @@ private:
                 productId[0] = toupper(input[0]);
                 productId[1] = '\0';
 
-                const Prod* product = catalog.findProductById(productId);
-                if (product == nullptr) {
+                ProductHandle product = catalog.findProductById(productId);
+                if (product == INVALID_PRODUCT_HANDLE) {
                     cout << "Product with ID '" << productId << "' not found." << endl;
                     continue;
                 }
@@ -609,7 +1852,7 @@ private:
                     validQuantity = true;
                 }
                 
-                cart.addProduct(*product, quantity);
+                cart.addProduct(product, quantity);
                 cout << "Product added successfully!" << endl;
                 validInput = true;
             }
@@ -673,10 +1916,15 @@ private:
             OrderManager& orderManager = OrderManager::getInstance();
             int orderId = orderManager.createOrder(cart, paymentMethod);
 
-            paymentMethod->pay(cart.getTotalAmount());
+            if (!paymentProcessor.submit(orderId, cart.getTotalAmount(), *paymentMethod)) {
+                orderManager.cancelOrder(orderId);
+                throw runtime_error("Error: Payment queue is full, please try again later!");
+            }
            
             cout << "You have successfully checked out the products!" << endl;
             cout << "Your order ID is: " << orderId << endl;
+            cout << "Payment of $" << fixed << setprecision(2) << cart.getTotalAmount()
+                 << " using " << paymentMethod->getMethodName() << " is being processed." << endl;
 
             cart.clear();
            
@@ -691,8 +1939,47 @@ private:
         OrderManager& orderManager = OrderManager::getInstance();
         orderManager.displayOrders();
     }
+
+    void exportOrders() {
+        char input[MAX_INPUT_LENGTH];
+
+        cout << "Select export format:\n";
+        cout << "1. Text\n";
+        cout << "2. CSV\n";
+        cout << "Enter your choice: ";
+        cin.getline(input, MAX_INPUT_LENGTH);
+
+        int formatChoice = parseFirstInteger(input);
+        if (formatChoice < 1 || formatChoice > 2) {
+            cout << "Invalid export format selected." << endl;
+            return;
+        }
+
+        ExportFormat format = (formatChoice == 2) ? EXPORT_CSV : EXPORT_TEXT;
+        const char* fileName = (format == EXPORT_CSV) ? "orders_export.csv" : "orders_export.txt";
+
+        ofstream exportFile(fileName);
+        if (!exportFile.is_open()) {
+            cout << "Error: Could not open " << fileName << " for writing!" << endl;
+            return;
+        }
+
+        int exported = OrderManager::getInstance().exportOrders(exportFile, format, exportPool);
+        exportFile.close();
+
+        cout << "Exported " << exported << " order(s) to " << fileName
+             << " using " << exportPool.getWorkerCount() << " thread(s)." << endl;
+    }
+
+    void viewPaymentStatistics() {
+        paymentProcessor.displayStats();
+    }
    
 public:
+    ShoppingApplication(const PaymentProcessorConfig& paymentConfig)
+        : paymentProcessor(paymentConfig, &ShoppingApplication::onPaymentSettled),
+          exportPool((int) thread::hardware_concurrency()) {}
+
     void run() {
         int choice;
         bool exitCondition = false;
@@ -723,6 +2010,12 @@ public:
                     viewOrders();
                     break;
                 case 4:
+                    exportOrders();
+                    break;
+                case 5:
+                    viewPaymentStatistics();
+                    break;
+                case 6:
                     exitCondition = true;
                     break;
                 default:
@@ -735,9 +2028,460 @@ public:
 };
 
 
-int main() {
+// Settles the same requests through the old one-call-per-payment path and
+// through the PaymentProcessor, and prints the throughput of both.
+void runPaymentBenchmark(const PaymentProcessorConfig& config) {
+    const int REQUEST_COUNT = 200;
+    CashPayment cash;
+    CardPayment card;
+    GCashPayment gcash;
+    PaymentStrategy* methods[] = { &cash, &card, &gcash };
+
+    cout << "Settling " << REQUEST_COUNT << " payments with "
+         << config.providerLatencyMs << " ms provider latency" << endl;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < REQUEST_COUNT; i++) {
+        ostringstream receipt;
+        this_thread::sleep_for(chrono::milliseconds(config.providerLatencyMs));
+        methods[i % 3]->pay(100.0 + i, receipt);
+    }
+    double blockingMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    PaymentProcessor processor(config, nullptr);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < REQUEST_COUNT; i++) {
+        processor.submit(i + 1, 100.0 + i, *methods[i % 3]);
+    }
+    processor.waitUntilIdle();
+    double queuedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << setw(30) << left << "Blocking (payments/s):" << fixed << setprecision(2)
+         << REQUEST_COUNT * 1000.0 / blockingMs << " in " << blockingMs << " ms" << endl;
+    cout << setw(30) << left << "Queued (payments/s):" << fixed << setprecision(2)
+         << REQUEST_COUNT * 1000.0 / queuedMs << " in " << queuedMs << " ms" << endl;
+    cout << setw(30) << left << "Speedup:" << fixed << setprecision(2) << blockingMs / queuedMs << "x" << endl;
+    processor.displayStats();
+}
+
+// Formats a large set of generated orders on one thread and on the export
+// pool, checks that both outputs match and prints the time taken by each.
+void runExportBenchmark(int orderCount) {
+    const int EXPORT_RUNS = 3;
+    const ProductCatalog& catalog = ProductCatalog::getInstance();
+    CashPayment cash;
+
+    if (orderCount < 1) orderCount = 1;
+
+    Order* orders = new Order[orderCount];
+    for (int i = 0; i < orderCount; i++) {
+        ShoppingCart cart;
+        int lines = 1 + i % 8;
+        for (int j = 0; j < lines; j++) {
+            cart.addProduct((ProductHandle) ((i + j) % catalog.getProductCount()), 1 + (i + j) % 5);
+        }
+        orders[i] = Order(i + 1, cart.getItems(), cart.getItemCount(), &cash);
+    }
+
+    WorkStealingPool serialPool(1);
+    WorkStealingPool parallelPool((int) thread::hardware_concurrency());
+
+    cout << "Exporting " << orderCount << " orders, best of " << EXPORT_RUNS
+         << " runs, " << parallelPool.getWorkerCount() << " worker thread(s) for "
+         << thread::hardware_concurrency() << " hardware thread(s)" << endl;
+    cout << setw(10) << left << "Format"
+         << setw(15) << right << "Serial (ms)"
+         << setw(15) << right << "Parallel (ms)"
+         << setw(10) << right << "Speedup"
+         << setw(12) << right << "Identical" << endl;
+
+    ExportFormat formats[] = { EXPORT_TEXT, EXPORT_CSV };
+    for (int f = 0; f < 2; f++) {
+        double bestMs[2] = { 0.0, 0.0 };
+        string output[2];
+        WorkStealingPool* pools[2] = { &serialPool, &parallelPool };
+
+        for (int p = 0; p < 2; p++) {
+            for (int run = 0; run < EXPORT_RUNS; run++) {
+                ostringstream out;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                OrderManager::writeOrders(out, orders, orderCount, formats[f], *pools[p]);
+                double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                if (run == 0 || elapsedMs < bestMs[p]) {
+                    bestMs[p] = elapsedMs;
+                }
+                if (run == 0) {
+                    output[p] = out.str();
+                }
+            }
+        }
+
+        cout << setw(10) << left << (formats[f] == EXPORT_CSV ? "CSV" : "Text")
+             << setw(15) << right << fixed << setprecision(2) << bestMs[0]
+             << setw(15) << right << fixed << setprecision(2) << bestMs[1]
+             << setw(9) << right << fixed << setprecision(2) << bestMs[0] / bestMs[1] << "x"
+             << setw(12) << right << (output[0] == output[1] ? "yes" : "NO") << endl;
+    }
+
+    delete[] orders;
+}
+
+// Compares the interned data model against copying the product into every line.
+void printMemoryReport() {
+    const ProductCatalog& catalog = ProductCatalog::getInstance();
+
+    cout << "\nMemory Report\n";
+    cout << setw(25) << left << ""
+         << setw(15) << right << "Inline (B)"
+         << setw(15) << right << "Interned (B)" << endl;
+    cout << setw(25) << left << "Cart / order line"
+         << setw(15) << right << sizeof(InlineCartItemLayout)
+         << setw(15) << right << sizeof(CartItem) << endl;
+    cout << setw(25) << left << "Lines per cache line"
+         << setw(15) << right << fixed << setprecision(2) << (double) CACHE_LINE_SIZE / sizeof(InlineCartItemLayout)
+         << setw(15) << right << CACHE_LINE_SIZE / sizeof(CartItem) << endl;
+    cout << setw(25) << left << "Order"
+         << setw(15) << right << sizeof(InlineOrderLayout)
+         << setw(15) << right << sizeof(Order) << endl;
+    cout << setw(25) << left << "Shopping cart"
+         << setw(15) << right << sizeof(InlineShoppingCartLayout)
+         << setw(15) << right << sizeof(ShoppingCart) << endl;
+    cout << setw(25) << left << "Order manager"
+         << setw(15) << right << sizeof(InlineOrderManagerLayout)
+         << setw(15) << right << sizeof(OrderManager) << endl;
+    cout << setw(25) << left << "Product catalog"
+         << setw(15) << right << sizeof(InlineProductCatalogLayout)
+         << setw(15) << right << sizeof(CatalogData) << endl;
+    cout << setw(25) << left << "String pool used / size"
+         << setw(15) << right << "-"
+         << setw(15) << right << catalog.getStringPoolBytes() << " / " << catalog.getStringPoolCapacity() << endl;
+    cout << "Interned sizes include fields added since, such as the order status "
+         << "and the order manager's lock." << endl;
+}
+
+// Moves the catalog and order IDs of this process into shared memory.
+bool enableSharedMode() {
+    SharedMemoryHost& host = SharedMemoryHost::getInstance();
+    ProductCatalog& catalog = ProductCatalog::getInstance();
+
+    if (!host.attach(catalog.getData())) {
+        return false;
+    }
+    catalog.attachShared(host.getCatalog());
+    OrderManager::getInstance().useSharedOrderIds(host.getOrderIdCounter());
+    return true;
+}
+
+// Sums one smaps field, in kB, over the mappings whose path contains
+// mappingName. Returns -1 where /proc is not available.
+long readSmapsKb(const char* mappingName, const char* field) {
+    ifstream smaps("/proc/self/smaps");
+    if (!smaps.is_open()) {
+        return -1;
+    }
+
+    size_t fieldLength = strlen(field);
+    bool inMapping = false;
+    bool found = false;
+    long total = 0;
+    char line[512];
+    while (smaps.getline(line, sizeof(line))) {
+        bool isFieldLine = (line[0] >= 'A' && line[0] <= 'Z');
+        if (!isFieldLine) {
+            inMapping = strstr(line, mappingName) != nullptr;
+        } else if (inMapping && strncmp(line, field, fieldLength) == 0 && line[fieldLength] == ':') {
+            total += atol(line + fieldLength + 1);
+            found = true;
+        }
+    }
+    return found ? total : -1;
+}
+
+// Resident memory, in kB, of the pages spanned by [address, address + size),
+// or -1 where mincore() is not available.
+long readResidentKb(const void* address, size_t size) {
+#ifdef __linux__
+    uintptr_t pageSize = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) address & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t) address + size + pageSize - 1) & ~(pageSize - 1);
+    size_t pageCount = (end - start) / pageSize;
+
+    unsigned char* residency = new unsigned char[pageCount];
+    long residentKb = -1;
+    if (mincore((void*) start, end - start, residency) == 0) {
+        size_t residentPages = 0;
+        for (size_t i = 0; i < pageCount; i++) {
+            if (residency[i] & 1) {
+                residentPages++;
+            }
+        }
+        residentKb = (long) (residentPages * pageSize / 1024);
+    }
+    delete[] residency;
+    return residentKb;
+#else
+    (void) address;
+    (void) size;
+    return -1;
+#endif
+}
+
+// Reads every page of the catalog so that it is fully resident, as it would
+// be in a long-running instance.
+void touchCatalogPages(const CatalogData& data) {
+    const volatile char* bytes = reinterpret_cast<const volatile char*>(&data);
+    for (size_t offset = 0; offset < sizeof(CatalogData); offset += 1024) {
+        (void) bytes[offset];
+    }
+}
+
+struct SharedSelfTestSample {
+    long localCatalogKb;
+    long sharedRssKb;
+    long sharedPssKb;
+};
+
+// Starts several processes that attach in shared mode at the same time, each
+// drawing order IDs through its OrderManager, and checks that no ID was
+// handed out twice. Every process stays attached until all IDs are
+// collected, as concurrently running instances would; the counter restarts
+// once the last process detaches. Each process also reports how much
+// resident memory its private catalog took before attaching and the Rss and
+// Pss of the shared catalog mapping afterwards.
+int runSharedMemorySelfTest(int processCount) {
+#ifdef _WIN32
+    (void) processCount;
+    cerr << "Error: Shared memory mode is not supported on this platform." << endl;
+    return 1;
+#else
+    const int IDS_PER_PROCESS = 1000;
+    const int ORDERS_PER_PROCESS = 5;
+    const int MAX_SELFTEST_PROCESSES = 64;
+
+    if (processCount < 2) processCount = 2;
+    if (processCount > MAX_SELFTEST_PROCESSES) processCount = MAX_SELFTEST_PROCESSES;
+
+    int idPipe[2];
+    int samplePipe[2];
+    int releasePipe[2];
+    if (pipe(idPipe) != 0 || pipe(samplePipe) != 0 || pipe(releasePipe) != 0) {
+        cerr << "Error: Could not create pipe: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    pid_t children[MAX_SELFTEST_PROCESSES];
+    int started = 0;
+    for (int p = 0; p < processCount; p++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(idPipe[0]);
+            close(samplePipe[0]);
+            close(releasePipe[1]);
+
+            SharedSelfTestSample sample;
+            ProductCatalog& catalog = ProductCatalog::getInstance();
+            touchCatalogPages(catalog.getData());
+            sample.localCatalogKb = readResidentKb(&catalog.getData(), sizeof(CatalogData));
+
+            if (!enableSharedMode()) {
+                cerr << "Error: " << SharedMemoryHost::getInstance().getLastError() << endl;
+                _exit(2);
+            }
+            bool catalogOk = catalog.isShared() && catalog.getProductCount() == 10
+                && strcmp(catalog.getProductName(0), "Lipstick") == 0;
+
+            touchCatalogPages(catalog.getData());
+
+            OrderManager& orderManager = OrderManager::getInstance();
+            orderManager.setLoggingEnabled(false);
+            CashPayment cash;
+            for (int i = 0; i < IDS_PER_PROCESS; i++) {
+                int id;
+                if (i < ORDERS_PER_PROCESS) {
+                    ShoppingCart cart;
+                    cart.addProduct((ProductHandle) (i % catalog.getProductCount()), 1);
+                    id = orderManager.createOrder(cart, &cash);
+                } else {
+                    id = orderManager.reserveOrderId();
+                }
+                if (write(idPipe[1], &id, sizeof(id)) != (ssize_t) sizeof(id)) {
+                    _exit(3);
+                }
+            }
+            close(idPipe[1]);
+
+            char release;
+            while (read(releasePipe[0], &release, 1) > 0) {
+            }
+
+            // Every process is attached at this point, so Pss shows the shared split.
+            sample.sharedRssKb = readSmapsKb(SHARED_CATALOG_NAME + 1, "Rss");
+            sample.sharedPssKb = readSmapsKb(SHARED_CATALOG_NAME + 1, "Pss");
+            if (write(samplePipe[1], &sample, sizeof(sample)) != (ssize_t) sizeof(sample)) {
+                _exit(3);
+            }
+            close(samplePipe[1]);
+
+            SharedMemoryHost::getInstance().detach();
+            _exit(catalogOk ? 0 : 4);
+        }
+        if (pid < 0) {
+            cerr << "Error: Could not start process: " << strerror(errno) << endl;
+            break;
+        }
+        children[started++] = pid;
+    }
+    close(idPipe[1]);
+    close(samplePipe[1]);
+    close(releasePipe[0]);
+
+    int* ids = new int[processCount * IDS_PER_PROCESS];
+    int idCount = 0;
+    int id;
+    while (idCount < processCount * IDS_PER_PROCESS && read(idPipe[0], &id, sizeof(id)) == (ssize_t) sizeof(id)) {
+        ids[idCount++] = id;
+    }
+    close(idPipe[0]);
+    close(releasePipe[1]);
+
+    SharedSelfTestSample sample;
+    int sampleCount = 0;
+    long localKb = 0;
+    long rssKb = 0;
+    long pssKb = 0;
+    bool measured = true;
+    while (read(samplePipe[0], &sample, sizeof(sample)) == (ssize_t) sizeof(sample)) {
+        if (sample.localCatalogKb < 0 || sample.sharedRssKb < 0 || sample.sharedPssKb < 0) {
+            measured = false;
+        }
+        localKb += sample.localCatalogKb;
+        rssKb += sample.sharedRssKb;
+        pssKb += sample.sharedPssKb;
+        sampleCount++;
+    }
+    close(samplePipe[0]);
+
+    int failedProcesses = 0;
+    for (int p = 0; p < started; p++) {
+        int status = 0;
+        waitpid(children[p], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failedProcesses++;
+        }
+    }
+
+    sort(ids, ids + idCount);
+    int duplicates = 0;
+    for (int i = 1; i < idCount; i++) {
+        if (ids[i] == ids[i - 1]) {
+            duplicates++;
+        }
+    }
+    delete[] ids;
+
+    cout << "\nShared Memory Self-Test\n";
+    cout << setw(40) << left << "Processes:" << started << " (" << failedProcesses << " failed)" << endl;
+    cout << setw(40) << left << "Order IDs allocated:" << idCount
+         << " (" << ORDERS_PER_PROCESS << " orders per process)" << endl;
+    cout << setw(40) << left << "Duplicate order IDs:" << duplicates << endl;
+    cout << setw(40) << left << "Shared counter updates:" << idCount / ORDER_ID_BLOCK_SIZE
+         << " (blocks of " << ORDER_ID_BLOCK_SIZE << ")" << endl;
+    if (measured && sampleCount > 0) {
+        cout << setw(40) << left << "Private catalog resident (kB):" << localKb / sampleCount << endl;
+        cout << setw(40) << left << "Shared catalog Rss / Pss (kB):" << rssKb / sampleCount
+             << " / " << pssKb / sampleCount << endl;
+        cout << setw(40) << left << "Saving per process (kB):" << (localKb - pssKb) / sampleCount << endl;
+    } else {
+        cout << setw(40) << left << "Memory per process:" << "not available (needs /proc/self/smaps)" << endl;
+    }
+
+    bool passed = (started == processCount && failedProcesses == 0
+        && idCount == processCount * IDS_PER_PROCESS && duplicates == 0);
+    cout << (passed ? "PASSED" : "FAILED") << endl;
+    return passed ? 0 : 1;
+#endif
+}
+
+// Reads the value of a "--name=value" argument, or -1 if it does not match.
+int parseIntegerOption(const char* arg, const char* name) {
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=') {
+        return -1;
+    }
+    return parseFirstInteger(arg + length + 1);
+}
+
+int main(int argc, char* argv[]) {
+    PaymentProcessorConfig paymentConfig;
+    bool benchmark = false;
+    int exportBenchmarkOrders = -1;
+    bool memoryReport = false;
+    bool sharedMode = false;
+    bool sharedReset = false;
+    int selfTestProcesses = -1;
+
+    for (int i = 1; i < argc; i++) {
+        int value;
+        if (strcmp(argv[i], "--payment-benchmark") == 0) {
+            benchmark = true;
+        } else if (strcmp(argv[i], "--export-benchmark") == 0) {
+            exportBenchmarkOrders = 20000;
+        } else if ((value = parseIntegerOption(argv[i], "--export-benchmark")) >= 0) {
+            exportBenchmarkOrders = value;
+        } else if (strcmp(argv[i], "--memory-report") == 0) {
+            memoryReport = true;
+        } else if (strcmp(argv[i], "--shared") == 0) {
+            sharedMode = true;
+        } else if (strcmp(argv[i], "--shared-reset") == 0) {
+            sharedReset = true;
+        } else if (strcmp(argv[i], "--shared-selftest") == 0) {
+            selfTestProcesses = 4;
+        } else if ((value = parseIntegerOption(argv[i], "--shared-selftest")) >= 0) {
+            selfTestProcesses = value;
+        } else if ((value = parseIntegerOption(argv[i], "--payment-workers")) >= 0) {
+            paymentConfig.workerCount = value;
+        } else if ((value = parseIntegerOption(argv[i], "--payment-batch")) >= 0) {
+            paymentConfig.maxBatchSize = value;
+        } else if ((value = parseIntegerOption(argv[i], "--payment-latency-ms")) >= 0) {
+            paymentConfig.providerLatencyMs = value;
+        } else if ((value = parseIntegerOption(argv[i], "--payment-decline-rate")) >= 0) {
+            paymentConfig.declineRatePercent = value;
+        } else {
+            cerr << "Warning: Ignoring unknown option '" << argv[i] << "'" << endl;
+        }
+    }
+
     try {
-        ShoppingApplication app;
+        if (benchmark) {
+            runPaymentBenchmark(paymentConfig);
+            return 0;
+        }
+        if (exportBenchmarkOrders >= 0) {
+            runExportBenchmark(exportBenchmarkOrders);
+            return 0;
+        }
+        if (memoryReport) {
+            printMemoryReport();
+            return 0;
+        }
+        if (sharedReset) {
+            SharedMemoryHost::removeSegments();
+            cout << "Removed the shared catalog and order ID segments." << endl;
+            return 0;
+        }
+        if (selfTestProcesses >= 0) {
+            return runSharedMemorySelfTest(selfTestProcesses);
+        }
+        if (sharedMode) {
+            // Private IDs would collide with attached instances, so never fall back.
+            if (!enableSharedMode()) {
+                cerr << "Error: " << SharedMemoryHost::getInstance().getLastError() << endl;
+                return 1;
+            }
+            cout << "Using the shared product catalog and order IDs." << endl;
+        }
+
+        ShoppingApplication app(paymentConfig);
         app.run();
     } catch (const exception& e) {
         cerr << "Fatal error: " << e.what() << endl;